@@ -0,0 +1,64 @@
+#include "alloc_stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifndef MUSIC_CATALOG_ALLOC_BUDGET
+#define MUSIC_CATALOG_ALLOC_BUDGET 0
+#endif
+
+static thread_local size_t thread_allocs = 0;
+
+static std::atomic<size_t> files{0};
+static std::atomic<size_t> total_allocs{0};
+static std::atomic<size_t> max_allocs{0};
+static std::atomic<size_t> over_budget{0};
+
+void *operator new(std::size_t size)
+{
+    ++thread_allocs;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+size_t thread_alloc_count()
+{
+    return thread_allocs;
+}
+
+void record_file_allocs(const std::filesystem::path &path, size_t allocs)
+{
+    ++files;
+    total_allocs += allocs;
+    size_t seen = max_allocs;
+    while (allocs > seen && !max_allocs.compare_exchange_weak(seen, allocs))
+        ;
+
+    if (MUSIC_CATALOG_ALLOC_BUDGET > 0 && allocs > MUSIC_CATALOG_ALLOC_BUDGET)
+    {
+        ++over_budget;
+        std::cerr << "Allocation budget exceeded: " << allocs << " > " << MUSIC_CATALOG_ALLOC_BUDGET
+                  << " in " << path << "\n";
+    }
+}
+
+bool report_alloc_stats()
+{
+    size_t n = files;
+    std::cout << "Scan allocations: " << total_allocs << " over " << n << " files"
+              << " (mean " << (n ? total_allocs / n : 0) << ", max " << max_allocs << ")\n";
+    return over_budget == 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Heap allocation accounting for the scan path. Only built with
+// -DMUSIC_CATALOG_ALLOC_STATS=ON, which replaces the global operator new;
+// callers guard their use with #ifdef MUSIC_CATALOG_ALLOC_STATS.
+
+#include <cstddef>
+#include <filesystem>
+
+// Allocations made by the calling thread so far.
+size_t thread_alloc_count();
+
+// Records the allocations spent on one scanned file.
+void record_file_allocs(const std::filesystem::path &path, size_t allocs);
+
+// Prints the per-file summary. Returns false if any file went over
+// MUSIC_CATALOG_ALLOC_BUDGET allocations (0 disables the check).
+bool report_alloc_stats();
@@ -0,0 +1,8 @@
+# builds with per-file allocation counting and runs the fixture scan under a budget
+# usage: check_alloc_budget.sh <allocations per file>
+set -e
+BUDGET=${1:?usage: check_alloc_budget.sh <allocations per file>}
+rm -rf build-alloc
+cmake -S . -B build-alloc -DCMAKE_BUILD_TYPE=RelWithDebInfo -DMUSIC_CATALOG_ALLOC_STATS=ON -DMUSIC_CATALOG_ALLOC_BUDGET="$BUDGET"
+cmake --build build-alloc
+ctest --test-dir build-alloc --output-on-failure
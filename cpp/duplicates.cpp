@@ -0,0 +1,364 @@
+#include "duplicates.hpp"
+
+#include <cstring>
+#include <fstream>
+
+// tracks of one recording in different formats rarely differ by more
+static constexpr int duration_tolerance_ms = 2000;
+
+int audio_duration_ms(const fs::path &path)
+{
+    TagLib::FileRef ref(path.c_str());
+    if (ref.isNull() || !ref.audioProperties())
+        return -1;
+    return ref.audioProperties()->lengthInMilliseconds();
+}
+
+static uint64_t big_endian(const char *p, size_t n)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; ++i)
+        value = (value << 8) | static_cast<unsigned char>(p[i]);
+    return value;
+}
+
+static uint64_t little_endian(const char *p, size_t n)
+{
+    uint64_t value = 0;
+    for (size_t i = n; i > 0; --i)
+        value = (value << 8) | static_cast<unsigned char>(p[i - 1]);
+    return value;
+}
+
+// FNV-1a over 64-bit little-endian words. Bytes are buffered until a word
+// is complete, so the digest does not depend on how the payload is chunked.
+class PayloadHash
+{
+public:
+    void update(const char *data, size_t n)
+    {
+        size_t i = 0;
+        while (pending_len_ > 0 && i < n) // top up a word left by the last call
+            push_byte(data[i++]);
+        for (; i + 8 <= n; i += 8)
+            mix(little_endian(data + i, 8));
+        while (i < n)
+            push_byte(data[i++]);
+    }
+
+    uint64_t digest()
+    {
+        if (pending_len_ > 0)
+            mix(pending_ ^ (uint64_t{pending_len_} << 56));
+        pending_ = 0;
+        pending_len_ = 0;
+        return hash_;
+    }
+
+private:
+    void mix(uint64_t word) { hash_ = (hash_ ^ word) * 0x100000001b3ULL; }
+
+    void push_byte(char c)
+    {
+        pending_ |= uint64_t{static_cast<unsigned char>(c)} << (8 * pending_len_);
+        if (++pending_len_ == 8)
+        {
+            mix(pending_);
+            pending_ = 0;
+            pending_len_ = 0;
+        }
+    }
+
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+    uint64_t pending_ = 0;
+    size_t pending_len_ = 0;
+};
+
+static bool read_at(std::istream &in, uint64_t pos, char *buf, size_t n)
+{
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(pos));
+    return static_cast<bool>(in.read(buf, static_cast<std::streamsize>(n)));
+}
+
+// Streams [begin, end) through the hash in fixed-size chunks so memory use
+// does not depend on file size.
+static bool hash_range(std::istream &in, uint64_t begin, uint64_t end, PayloadHash &hash)
+{
+    constexpr size_t chunk_size = 1 << 16;
+    std::vector<char> chunk(chunk_size);
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(begin));
+    for (uint64_t remaining = end - begin; remaining > 0;)
+    {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, chunk_size));
+        if (!in.read(chunk.data(), static_cast<std::streamsize>(want)))
+            return false;
+        hash.update(chunk.data(), want);
+        remaining -= want;
+    }
+    return true;
+}
+
+// Offset just past a leading ID3v2 tag, or 0 when there is none.
+static uint64_t skip_id3v2(std::istream &in)
+{
+    char header[10];
+    if (!read_at(in, 0, header, sizeof(header)) || std::memcmp(header, "ID3", 3) != 0)
+        return 0;
+    uint64_t size = 0;
+    for (int i = 6; i < 10; ++i)
+        size = (size << 7) | (static_cast<unsigned char>(header[i]) & 0x7f); // syncsafe
+    bool footer = header[5] & 0x10;
+    return 10 + size + (footer ? 10 : 0);
+}
+
+// MPEG frames between a leading ID3v2 tag and trailing APEv2/ID3v1 tags.
+static std::optional<uint64_t> fingerprint_mpeg(std::istream &in, uint64_t size)
+{
+    uint64_t begin = skip_id3v2(in);
+    uint64_t end = size;
+
+    char buf[32];
+    if (end >= begin + 128 && read_at(in, end - 128, buf, 3) && std::memcmp(buf, "TAG", 3) == 0)
+        end -= 128;
+    if (end >= begin + 32 && read_at(in, end - 32, buf, 32) && std::memcmp(buf, "APETAGEX", 8) == 0)
+    {
+        uint64_t tag_size = little_endian(buf + 12, 4); // items + footer
+        bool has_header = little_endian(buf + 20, 4) & 0x80000000u;
+        tag_size += has_header ? 32 : 0;
+        if (tag_size > end - begin)
+            return std::nullopt;
+        end -= tag_size;
+    }
+    if (end <= begin)
+        return std::nullopt;
+
+    PayloadHash hash;
+    if (!hash_range(in, begin, end, hash))
+        return std::nullopt;
+    return hash.digest();
+}
+
+// The STREAMINFO MD5 of the decoded audio when the encoder recorded one,
+// otherwise the frames after the last metadata block.
+static std::optional<uint64_t> fingerprint_flac(std::istream &in, uint64_t size)
+{
+    uint64_t pos = skip_id3v2(in);
+    char buf[34];
+    if (!read_at(in, pos, buf, 4) || std::memcmp(buf, "fLaC", 4) != 0)
+        return std::nullopt;
+    pos += 4;
+
+    std::optional<std::string> md5;
+    for (bool last = false; !last;)
+    {
+        if (!read_at(in, pos, buf, 4))
+            return std::nullopt;
+        last = buf[0] & 0x80;
+        int type = buf[0] & 0x7f;
+        uint64_t length = big_endian(buf + 1, 3);
+        if (type == 0 && length >= 34)
+        {
+            if (!read_at(in, pos + 4, buf, 34))
+                return std::nullopt;
+            md5.emplace(buf + 18, 16);
+        }
+        pos += 4 + length;
+    }
+    if (pos >= size)
+        return std::nullopt;
+
+    PayloadHash hash;
+    if (md5 && md5->find_first_not_of('\0') != std::string::npos)
+    {
+        hash.update(md5->data(), md5->size());
+        return hash.digest();
+    }
+    if (!hash_range(in, pos, size, hash))
+        return std::nullopt;
+    return hash.digest();
+}
+
+// Every top-level mdat box; metadata lives in moov/udta and is skipped.
+static std::optional<uint64_t> fingerprint_mp4(std::istream &in, uint64_t size)
+{
+    PayloadHash hash;
+    bool found = false;
+    char buf[16];
+
+    for (uint64_t pos = 0; pos + 8 <= size;)
+    {
+        if (!read_at(in, pos, buf, 8))
+            return std::nullopt;
+        uint64_t box_size = big_endian(buf, 4);
+        uint64_t header = 8;
+        if (box_size == 1)
+        {
+            if (!read_at(in, pos + 8, buf + 8, 8))
+                return std::nullopt;
+            box_size = big_endian(buf + 8, 8);
+            header = 16;
+        }
+        else if (box_size == 0)
+        {
+            box_size = size - pos; // extends to end of file
+        }
+        if (box_size < header || box_size > size - pos)
+            return std::nullopt;
+
+        if (std::memcmp(buf + 4, "mdat", 4) == 0)
+        {
+            if (!hash_range(in, pos + header, pos + box_size, hash))
+                return std::nullopt;
+            found = true;
+        }
+        pos += box_size;
+    }
+
+    if (!found)
+        return std::nullopt;
+    return hash.digest();
+}
+
+// Page bodies after the codec header packets (OpusHead + OpusTags, or the
+// three Vorbis headers). Page headers are left out because their sequence
+// numbers and CRCs shift when the comment packet changes size.
+static std::optional<uint64_t> fingerprint_ogg(std::istream &in, uint64_t size, int header_packets)
+{
+    PayloadHash hash;
+    int packets_seen = 0;
+    bool hashed = false;
+    char header[27];
+    unsigned char lacing[255];
+    std::vector<char> body;
+
+    for (uint64_t pos = 0; pos + 27 <= size;)
+    {
+        if (!read_at(in, pos, header, sizeof(header)) || std::memcmp(header, "OggS", 4) != 0)
+            return std::nullopt;
+        size_t segments = static_cast<unsigned char>(header[26]);
+        if (!in.read(reinterpret_cast<char *>(lacing), static_cast<std::streamsize>(segments)))
+            return std::nullopt;
+
+        size_t body_size = 0;
+        for (size_t i = 0; i < segments; ++i)
+            body_size += lacing[i];
+        body.resize(body_size);
+        if (!in.read(body.data(), static_cast<std::streamsize>(body_size)))
+            return std::nullopt;
+
+        size_t offset = 0;
+        for (size_t i = 0; i < segments; ++i)
+        {
+            if (packets_seen >= header_packets)
+            {
+                hash.update(body.data() + offset, lacing[i]);
+                hashed = true;
+            }
+            else if (lacing[i] < 255)
+            {
+                ++packets_seen; // a segment shorter than 255 ends a packet
+            }
+            offset += lacing[i];
+        }
+        pos += 27 + segments + body_size;
+    }
+
+    if (!hashed)
+        return std::nullopt;
+    return hash.digest();
+}
+
+std::optional<uint64_t> audio_fingerprint(const fs::path &path)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    std::ifstream in(path, std::ios::binary);
+    if (ec || !in)
+        return std::nullopt;
+
+    std::string ext = get_lowercase_ext(path);
+    if (ext == "mp3")
+        return fingerprint_mpeg(in, size);
+    if (ext == "flac")
+        return fingerprint_flac(in, size);
+    if (ext == "m4a")
+        return fingerprint_mp4(in, size);
+    if (ext == "ogg")
+        return fingerprint_ogg(in, size, 3);
+    if (ext == "opus")
+        return fingerprint_ogg(in, size, 2);
+    return std::nullopt;
+}
+
+static void verify_group(const DuplicateGroup &candidate, const fs::path &directory, std::vector<DuplicateGroup> &out)
+{
+    std::vector<DuplicateTrack> tracks = candidate.tracks;
+    for (auto &track : tracks)
+    {
+        fs::path path = directory / track.song->path;
+        track.duration_ms = audio_duration_ms(path);
+        track.fingerprint = audio_fingerprint(path);
+        if (!track.fingerprint)
+            std::cerr << "Cannot fingerprint audio of " << path << "\n";
+    }
+
+    std::sort(tracks.begin(), tracks.end(), [](const DuplicateTrack &a, const DuplicateTrack &b)
+              { return a.duration_ms < b.duration_ms; });
+
+    // split wherever consecutive durations drift apart
+    size_t start = 0;
+    for (size_t i = 1; i <= tracks.size(); ++i)
+    {
+        if (i < tracks.size() && tracks[i].duration_ms - tracks[i - 1].duration_ms <= duration_tolerance_ms)
+            continue;
+
+        if (i - start >= 2)
+        {
+            DuplicateGroup group;
+            group.tracks.assign(tracks.begin() + start, tracks.begin() + i);
+            group.verified = true;
+
+            std::map<std::string, std::vector<const DuplicateTrack *>> by_format;
+            for (const auto &track : group.tracks)
+                by_format[get_lowercase_ext(track.song->path)].push_back(&track);
+            for (const auto &[format, same] : by_format)
+            {
+                if (same.size() < 2)
+                    continue;
+                group.identical_audio[format] = std::all_of(same.begin(), same.end(), [&](const DuplicateTrack *t)
+                                                            { return t->fingerprint && t->fingerprint == same.front()->fingerprint; });
+            }
+            out.push_back(std::move(group));
+        }
+        start = i;
+    }
+}
+
+std::vector<DuplicateGroup> find_duplicates(const std::vector<Song> &songs, const fs::path &directory, bool verify_audio)
+{
+    std::unordered_map<std::string, size_t> group_of;
+    std::vector<DuplicateGroup> candidates;
+    group_of.reserve(songs.size());
+
+    for (const auto &song : songs)
+    {
+        auto [it, inserted] = group_of.try_emplace(duplicate_key(song), candidates.size());
+        if (inserted)
+            candidates.emplace_back();
+        candidates[it->second].tracks.push_back(DuplicateTrack{&song});
+    }
+
+    std::vector<DuplicateGroup> groups;
+    for (auto &candidate : candidates)
+    {
+        if (candidate.tracks.size() < 2)
+            continue;
+        if (verify_audio)
+            verify_group(candidate, directory, groups);
+        else
+            groups.push_back(std::move(candidate));
+    }
+    return groups;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "song.hpp"
+#include <map>
+
+struct DuplicateTrack
+{
+    const Song *song;
+    int duration_ms = -1;                // only filled in when verifying audio
+    std::optional<uint64_t> fingerprint{}; // only filled in when verifying audio
+};
+
+struct DuplicateGroup
+{
+    std::vector<DuplicateTrack> tracks;
+    bool verified = false;
+    // Per file format held by two or more tracks: whether they all share one
+    // successfully computed fingerprint. Fingerprints hash the encoded audio,
+    // so copies in different formats are only compared by duration.
+    std::map<std::string, bool> identical_audio;
+};
+
+// Groups songs that compare equal under Song::operator== by hashing their
+// collation keys, so the work is linear in the catalog size. With
+// `verify_audio`, each candidate group is split by track duration and its
+// members are fingerprinted; only groups still holding two or more tracks
+// are returned.
+std::vector<DuplicateGroup> find_duplicates(const std::vector<Song> &songs, const fs::path &directory, bool verify_audio);
+
+int audio_duration_ms(const fs::path &path);
+// Hash of the audio payload only, so copies that differ just in their tags
+// match. Empty when the file cannot be read or its container is malformed.
+std::optional<uint64_t> audio_fingerprint(const fs::path &path);
@@ -1,17 +1,75 @@
 #include "song.hpp"
 #include "yaml_io.hpp"
 #include "playlist.hpp"
+#include "duplicates.hpp"
+#include "pipeline.hpp"
+#ifdef MUSIC_CATALOG_ALLOC_STATS
+#include "alloc_stats.hpp"
+#endif
 
 int main(int argc, char *argv[])
 {
-    if (argc < 2)
+    bool find_dups = false;
+    bool verify_audio = false;
+    bool bad_args = false;
+    size_t max_memory = 0; // unlimited
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i)
     {
-        std::cerr << "Usage: " << argv[0] << " <music_directory>" << std::endl;
+        std::string arg = argv[i];
+        if (arg == "--find-duplicates")
+        {
+            find_dups = true;
+        }
+        else if (arg == "--verify-audio")
+        {
+            verify_audio = true;
+        }
+        else if (arg == "--max-memory" && i + 1 < argc)
+        {
+            try
+            {
+                max_memory = parse_memory_size(argv[++i]);
+            }
+            catch (const std::exception &)
+            {
+                bad_args = true;
+            }
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+
+    if (bad_args || positional.size() != 1 || (verify_audio && !find_dups))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--max-memory <size>[K|M|G]] <music_directory>\n"
+                  << "       " << argv[0] << " --find-duplicates [--verify-audio] <music_directory>" << std::endl;
         return 1;
     }
 
-    std::string directory = argv[1];
-    std::vector<Song> songs = parse_all_songs(directory);
-    write_songs_to_yaml(songs, "songs.yaml");
-    generate_playlists_from_config(songs, "playlists.yaml", "playlists");
-}
\ No newline at end of file
+    std::string directory = positional.front();
+    if (find_dups)
+    {
+        std::vector<Song> songs = parse_all_songs(directory, false); // report only: never rename
+        write_duplicates_to_yaml(find_duplicates(songs, directory, verify_audio), "duplicates.yaml");
+    }
+    else
+    {
+        // the sorter's last run stays in memory while the playlists fill, so they split the budget
+        size_t sort_memory = max_memory == 0 ? 0 : std::max<size_t>(1, max_memory - max_memory / 2);
+        size_t playlist_memory = max_memory == 0 ? 0 : std::max<size_t>(1, max_memory / 2);
+
+        // sinks are built first so a broken playlists.yaml fails before the scan
+        YamlSongSink yaml_sink("songs.yaml");
+        PlaylistSink playlist_sink("playlists.yaml", "playlists", playlist_memory);
+        stream_sorted_songs(directory, sort_memory, {&yaml_sink, &playlist_sink});
+    }
+
+#ifdef MUSIC_CATALOG_ALLOC_STATS
+    if (!report_alloc_stats())
+        return 2;
+#endif
+}
@@ -0,0 +1,240 @@
+#include "pipeline.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <thread>
+
+void write_string(std::ostream &out, const std::string &s)
+{
+    uint32_t len = static_cast<uint32_t>(s.size());
+    out.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    out.write(s.data(), len);
+}
+
+bool read_string(std::istream &in, std::string &s)
+{
+    uint32_t len;
+    if (!in.read(reinterpret_cast<char *>(&len), sizeof(len)))
+        return false;
+    s.resize(len);
+    return static_cast<bool>(in.read(s.data(), len));
+}
+
+static void write_string_vector(std::ostream &out, const std::vector<std::string> &vec)
+{
+    uint32_t count = static_cast<uint32_t>(vec.size());
+    out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const auto &s : vec)
+        write_string(out, s);
+}
+
+static bool read_string_vector(std::istream &in, std::vector<std::string> &vec)
+{
+    uint32_t count;
+    if (!in.read(reinterpret_cast<char *>(&count), sizeof(count)))
+        return false;
+    vec.resize(count);
+    for (auto &s : vec)
+    {
+        if (!read_string(in, s))
+            return false;
+    }
+    return true;
+}
+
+static void write_song(std::ostream &out, const Song &song)
+{
+    write_string(out, song.title);
+    write_string_vector(out, song.artist);
+    write_string(out, song.album);
+    write_string_vector(out, song.genre);
+    int32_t rating = song.rating;
+    out.write(reinterpret_cast<const char *>(&rating), sizeof(rating));
+    write_string(out, song.discnumber);
+    write_string(out, song.tracknumber);
+    write_string(out, song.path);
+    write_string(out, song.date_added);
+}
+
+static bool read_song(std::istream &in, Song &song)
+{
+    int32_t rating;
+    bool ok = read_string(in, song.title) &&
+              read_string_vector(in, song.artist) &&
+              read_string(in, song.album) &&
+              read_string_vector(in, song.genre) &&
+              in.read(reinterpret_cast<char *>(&rating), sizeof(rating)) &&
+              read_string(in, song.discnumber) &&
+              read_string(in, song.tracknumber) &&
+              read_string(in, song.path) &&
+              read_string(in, song.date_added);
+    song.rating = rating;
+    return ok;
+}
+
+// heap bytes only: strings up to 15 chars live in the small-string buffer
+size_t string_footprint(const std::string &s)
+{
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+// the Song itself is not included: it is counted through the buffer's capacity
+size_t song_footprint(const Song &song)
+{
+    auto heap = string_footprint;
+
+    size_t bytes = heap(song.title) + heap(song.album) + heap(song.discnumber) +
+                   heap(song.tracknumber) + heap(song.path) + heap(song.date_added);
+    for (const auto *vec : {&song.artist, &song.genre})
+    {
+        bytes += vec->capacity() * sizeof(std::string);
+        for (const auto &s : *vec)
+            bytes += heap(s);
+    }
+    return bytes;
+}
+
+size_t parse_memory_size(const std::string &s)
+{
+    size_t pos = 0;
+    unsigned long long value = std::stoull(s, &pos);
+    std::string unit = s.substr(pos);
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::toupper);
+
+    if (unit.empty() || unit == "B")
+        return value;
+    if (unit == "K" || unit == "KB" || unit == "KIB")
+        return value << 10;
+    if (unit == "M" || unit == "MB" || unit == "MIB")
+        return value << 20;
+    if (unit == "G" || unit == "GB" || unit == "GIB")
+        return value << 30;
+    throw std::invalid_argument("Unknown memory size unit: " + s);
+}
+
+SpillDir::~SpillDir()
+{
+    if (!path_.empty())
+    {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+}
+
+const fs::path &SpillDir::path()
+{
+    if (path_.empty())
+    {
+        path_ = fs::temp_directory_path() / ("music-catalog-" + std::to_string(std::random_device{}()));
+        fs::create_directories(path_);
+    }
+    return path_;
+}
+
+SongSorter::SongSorter(size_t memory_budget) : memory_budget_(memory_budget) {}
+
+void SongSorter::reserve(size_t expected)
+{
+    // under a budget, leave most of it for the songs' own strings
+    if (memory_budget_ > 0)
+        expected = std::min(expected, memory_budget_ / (4 * sizeof(Song)));
+    buffer_.reserve(expected);
+}
+
+void SongSorter::add(Song &&song)
+{
+    // the whole capacity counts, reserved slots and the growth of this push_back included
+    size_t bytes = song_footprint(song);
+    if (memory_budget_ > 0 && !buffer_.empty() &&
+        buffered_bytes_ + bytes + capacity_after_push(buffer_) * sizeof(Song) > memory_budget_)
+        spill();
+
+    buffered_bytes_ += bytes;
+    buffer_.push_back(std::move(song));
+    ++count_;
+}
+
+void SongSorter::spill()
+{
+    std::sort(buffer_.begin(), buffer_.end());
+    fs::path run = spill_dir_.path() / ("run-" + std::to_string(runs_.size()));
+    std::ofstream out(run, std::ios::binary);
+    for (const auto &song : buffer_)
+        write_song(out, song);
+    if (!out)
+        throw std::runtime_error("Failed to write sort run " + run.string());
+
+    runs_.push_back(run);
+    buffer_.clear(); // the capacity grew within the budget, so keep it for the next run
+    buffered_bytes_ = 0;
+}
+
+void SongSorter::drain(const std::function<void(const Song &)> &emit)
+{
+    std::sort(buffer_.begin(), buffer_.end());
+    if (runs_.empty())
+    {
+        for (const auto &song : buffer_)
+            emit(song);
+        return;
+    }
+
+    merge_runs(runs_, spill_dir_.path(), buffer_, read_song, write_song, std::less<Song>{}, emit);
+}
+
+void stream_sorted_songs(const std::string &directory, size_t memory_budget, const std::vector<SongSink *> &sinks)
+{
+    BoundedQueue<Song> queue(64);
+    SongSorter sorter(memory_budget);
+    sorter.reserve(count_directory_entries(directory));
+    std::exception_ptr scan_error;
+    std::atomic<bool> cancelled = false;
+
+    std::thread producer([&]
+                         {
+                             try
+                             {
+                                 scan_songs(directory, true, [&](Song &&song)
+                                            {
+                                                queue.push(std::move(song));
+                                                // stop walking (and renaming) once the consumer has failed
+                                                if (cancelled)
+                                                    throw std::runtime_error("Scan cancelled");
+                                            });
+                             }
+                             catch (...)
+                             {
+                                 scan_error = std::current_exception();
+                             }
+                             queue.close(); });
+
+    try
+    {
+        while (auto song = queue.pop())
+            sorter.add(std::move(*song));
+    }
+    catch (...)
+    {
+        cancelled = true;
+        queue.close(); // unblock the producer before unwinding
+        producer.join();
+        throw;
+    }
+    producer.join();
+    if (scan_error)
+        std::rethrow_exception(scan_error);
+
+    if (sorter.spilled_runs() > 0)
+        std::cout << "Sorted " << sorter.size() << " songs with " << sorter.spilled_runs() << " runs spilled to disk\n";
+
+    for (auto *sink : sinks)
+        sink->begin(sorter.size());
+    sorter.drain([&](const Song &song)
+                 {
+                     for (auto *sink : sinks)
+                         sink->consume(song); });
+    for (auto *sink : sinks)
+        sink->finish();
+}
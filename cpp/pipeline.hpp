@@ -0,0 +1,217 @@
+#pragma once
+
+#include "song.hpp"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <optional>
+
+// Fixed-capacity queue between the scanning thread and the sorter; push
+// blocks while full so a fast scan cannot outrun memory.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(T &&item)
+    {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [&]
+                       { return items_.size() < capacity_ || closed_; });
+        if (closed_)
+            return;
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+    }
+
+    // Empty once the queue is closed and drained.
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [&]
+                        { return !items_.empty() || closed_; });
+        if (items_.empty())
+            return std::nullopt;
+        T item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_ = false;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+// Receives every song once, in catalog order.
+class SongSink
+{
+public:
+    virtual ~SongSink() = default;
+    virtual void begin(size_t total) = 0;
+    virtual void consume(const Song &song) = 0;
+    virtual void finish() = 0;
+};
+
+// Temporary directory for spilled runs, created on first use and removed
+// with its contents on destruction.
+class SpillDir
+{
+public:
+    SpillDir() = default;
+    ~SpillDir();
+    SpillDir(const SpillDir &) = delete;
+    SpillDir &operator=(const SpillDir &) = delete;
+
+    const fs::path &path();
+
+private:
+    fs::path path_;
+};
+
+// Length-prefixed strings, the building block of every run file record.
+void write_string(std::ostream &out, const std::string &s);
+bool read_string(std::istream &in, std::string &s);
+
+// Capacity after one more push_back; a full vector doubles.
+template <typename T>
+size_t capacity_after_push(const std::vector<T> &vec)
+{
+    return vec.size() < vec.capacity() ? vec.capacity() : std::max<size_t>(1, 2 * vec.capacity());
+}
+
+// Most run files kept open by one merge; more runs are merged in passes.
+constexpr size_t max_merge_fan_in = 16;
+
+// k-way merge of sorted run files plus one sorted in-memory run.
+template <typename T, typename Read, typename Less, typename Emit>
+void merge_sorted_runs(const std::vector<fs::path> &runs, const std::vector<T> &memory, Read read, Less less, Emit emit)
+{
+    struct Cursor
+    {
+        std::ifstream in;
+        T head;
+    };
+    std::vector<Cursor> cursors(runs.size());
+    size_t memory_next = 0;
+
+    auto advance = [&](size_t r)
+    { return read(cursors[r].in, cursors[r].head); };
+
+    // heap entries index into cursors; runs.size() stands for the memory run
+    const size_t memory_run = runs.size();
+    auto head = [&](size_t r) -> const T &
+    { return r == memory_run ? memory[memory_next] : cursors[r].head; };
+    auto later = [&](size_t a, size_t b)
+    { return less(head(b), head(a)); };
+    std::vector<size_t> heap;
+
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        cursors[r].in.open(runs[r], std::ios::binary);
+        if (!cursors[r].in)
+            throw std::runtime_error("Failed to open sort run " + runs[r].string());
+        if (advance(r))
+            heap.push_back(r);
+    }
+    if (!memory.empty())
+        heap.push_back(memory_run);
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t r = heap.back();
+        emit(head(r));
+
+        bool more = r == memory_run ? ++memory_next < memory.size() : advance(r);
+        if (more)
+            std::push_heap(heap.begin(), heap.end(), later);
+        else
+            heap.pop_back();
+    }
+}
+
+// Merges `runs` into `emit`, first collapsing them in groups of
+// max_merge_fan_in into intermediate runs under `dir` until few enough remain.
+template <typename T, typename Read, typename Write, typename Less, typename Emit>
+void merge_runs(std::vector<fs::path> runs, const fs::path &dir, const std::vector<T> &memory,
+                Read read, Write write, Less less, Emit emit)
+{
+    for (size_t pass = 0; runs.size() > max_merge_fan_in; ++pass)
+    {
+        std::vector<fs::path> merged;
+        for (size_t first = 0; first < runs.size(); first += max_merge_fan_in)
+        {
+            size_t last = std::min(first + max_merge_fan_in, runs.size());
+            std::vector<fs::path> group(runs.begin() + first, runs.begin() + last);
+            if (group.size() == 1)
+            {
+                merged.push_back(group.front());
+                continue;
+            }
+
+            fs::path path = dir / ("merge-" + std::to_string(pass) + "-" + std::to_string(merged.size()));
+            std::ofstream out(path, std::ios::binary);
+            merge_sorted_runs(group, std::vector<T>{}, read, less, [&](const T &record)
+                              { write(out, record); });
+            if (!out)
+                throw std::runtime_error("Failed to write sort run " + path.string());
+
+            for (const auto &run : group)
+                fs::remove(run);
+            merged.push_back(path);
+        }
+        runs = std::move(merged);
+    }
+    merge_sorted_runs(runs, memory, read, less, emit);
+}
+
+// External merge sort for songs: runs are sorted in memory and spilled to
+// disk whenever the buffer, counted at its full capacity plus the songs'
+// strings, would exceed `memory_budget` bytes (0 means never spill), then
+// merged back in Song::operator<=> order with at most max_merge_fan_in runs
+// open at once.
+class SongSorter
+{
+public:
+    explicit SongSorter(size_t memory_budget);
+
+    void reserve(size_t expected);
+    void add(Song &&song);
+    size_t size() const { return count_; }
+    size_t spilled_runs() const { return runs_.size(); }
+    void drain(const std::function<void(const Song &)> &emit);
+
+private:
+    void spill();
+
+    size_t memory_budget_;
+    size_t buffered_bytes_ = 0;
+    size_t count_ = 0;
+    std::vector<Song> buffer_;
+    SpillDir spill_dir_;
+    std::vector<fs::path> runs_;
+};
+
+size_t string_footprint(const std::string &s);
+size_t song_footprint(const Song &song);
+size_t parse_memory_size(const std::string &s);
+
+// Scans `directory` on a producer thread and streams the sorted catalog into
+// every sink, keeping buffered songs under `memory_budget` bytes.
+void stream_sorted_songs(const std::string &directory, size_t memory_budget, const std::vector<SongSink *> &sinks);
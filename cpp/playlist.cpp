@@ -25,145 +25,691 @@ std::vector<PlaylistConfig> load_playlist_config(const std::string &config_path)
             }
         }
 
-        if (node["conditions"])
+        if (node["shuffle"])
         {
-            for (const auto &it : node["conditions"])
-            {
-                std::string key = it.first.as<std::string>();
-                FieldCondition cond;
-
-                if (it.second.IsScalar())
-                {
-                    if (it.second.Tag().find("int") != std::string::npos)
-                        cond.int_value = it.second.as<int>();
-                    else
-                        cond.str_value = it.second.as<std::string>();
-                }
-                else if (it.second["min"] || it.second["max"])
-                {
-                    if (it.second["min"])
-                        cond.min = it.second["min"].as<int>();
-                    if (it.second["max"])
-                        cond.max = it.second["max"].as<int>();
-                }
-                else if (it.second["any"])
-                {
-                    for (const auto &val : it.second["any"])
-                    {
-                        cond.any.push_back(val.as<std::string>());
-                    }
-                }
-
-                config.conditions[key] = cond;
-            }
+            if (!node["shuffle"].IsScalar() || node["shuffle"].as<bool>())
+                config.shuffle = parse_shuffle_config(node["shuffle"]);
         }
 
+        if (node["conditions"])
+            config.conditions = parse_condition_map(node["conditions"]);
+
         configs.push_back(config);
     }
 
     return configs;
 }
 
-static const std::unordered_map<std::string, MatchFunc> match_funcs = {
-    {"title", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.title, c); }},
-    {"album", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.album, c); }},
-    {"discnumber", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.discnumber, c); }},
-    {"tracknumber", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.tracknumber, c); }},
-    {"path", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.path, c); }},
-    {"date_added", [](const Song &s, const FieldCondition &c)
-     { return match_string_field(s.date_added, c); }},
-    {"rating", [](const Song &s, const FieldCondition &c)
-     { return match_int_field(s.rating, c); }},
-    {"artist", [](const Song &s, const FieldCondition &c)
-     { return match_string_vector_field(s.artist, c); }},
-    {"genre", [](const Song &s, const FieldCondition &c)
-     { return match_string_vector_field(s.genre, c); }},
+ShuffleConfig parse_shuffle_config(const YAML::Node &node)
+{
+    ShuffleConfig cfg;
+    if (node.IsScalar())
+        return cfg; // "shuffle: true"
+
+    if (node["seed"])
+        cfg.seed = node["seed"].as<uint64_t>();
+    if (node["min_artist_gap"])
+        cfg.min_artist_gap = node["min_artist_gap"].as<int>();
+    if (node["spread_albums"])
+        cfg.spread_albums = node["spread_albums"].as<bool>();
+    return cfg;
+}
+
+static const std::unordered_map<std::string, FieldSpec> field_specs = {
+    {"title", {FieldSpec::Kind::Text, 0, nullptr, [](const Song &s) -> const std::string & { return s.title; }}},
+    {"album", {FieldSpec::Kind::Text, 1, nullptr, [](const Song &s) -> const std::string & { return s.album; }}},
+    {"discnumber", {FieldSpec::Kind::Text, 2, nullptr, [](const Song &s) -> const std::string & { return s.discnumber; }}},
+    {"tracknumber", {FieldSpec::Kind::Text, 3, nullptr, [](const Song &s) -> const std::string & { return s.tracknumber; }}},
+    {"path", {FieldSpec::Kind::Text, 4, nullptr, [](const Song &s) -> const std::string & { return s.path; }}},
+    {"date_added", {FieldSpec::Kind::Text, 5, nullptr, [](const Song &s) -> const std::string & { return s.date_added; }}},
+    {"rating", {FieldSpec::Kind::Int, 6, [](const Song &s) { return s.rating; }}},
+    {"artist", {FieldSpec::Kind::TextList, 7, nullptr, nullptr, [](const Song &s) -> const std::vector<std::string> & { return s.artist; }}},
+    {"genre", {FieldSpec::Kind::TextList, 8, nullptr, nullptr, [](const Song &s) -> const std::vector<std::string> & { return s.genre; }}},
 };
 
-void generate_playlists_from_config(const std::vector<Song> &songs, const std::string &config_path, const std::string &out_dir)
+const FieldSpec &field_spec(const std::string &field)
 {
-    std::vector<PlaylistConfig> configs = load_playlist_config(config_path);
+    auto it = field_specs.find(field);
+    if (it == field_specs.end())
+        throw std::runtime_error("Unknown playlist field \"" + field + "\"");
+    return it->second;
+}
 
-    for (const auto &cfg : configs)
+static std::vector<std::string> as_string_list(const YAML::Node &node)
+{
+    std::vector<std::string> result;
+    if (node.IsScalar())
+    {
+        result.push_back(node.as<std::string>());
+    }
+    else
+    {
+        for (const auto &val : node)
+            result.push_back(val.as<std::string>());
+    }
+    return result;
+}
+
+static int as_int_operand(const std::string &field, const std::string &op, const YAML::Node &node)
+{
+    int value;
+    if (!YAML::convert<int>::decode(node, value))
+        throw std::runtime_error("Field \"" + field + "\" needs an integer for \"" + op + "\"");
+    return value;
+}
+
+FieldCondition parse_field_condition(const std::string &field, const YAML::Node &node)
+{
+    static const std::vector<std::string> int_ops = {"min", "max", "not"};
+    static const std::vector<std::string> text_ops = {"any", "none_of", "not", "contains", "regex", "ignore_case"};
+
+    const FieldSpec &spec = field_spec(field);
+    const bool is_int = spec.kind == FieldSpec::Kind::Int;
+    FieldCondition cond;
+
+    if (node.IsScalar())
+    {
+        if (is_int)
+            cond.int_value = as_int_operand(field, "=", node);
+        else
+            cond.str_value = node.as<std::string>();
+        return cond;
+    }
+    if (!node.IsMap())
+        throw std::runtime_error("Field \"" + field + "\" needs a value or a map of operators");
+
+    // reject typos and operators the field's type cannot evaluate, rather
+    // than ignoring them and matching every song
+    const auto &allowed = is_int ? int_ops : text_ops;
+    for (const auto &it : node)
+    {
+        std::string op = it.first.as<std::string>();
+        if (std::find(allowed.begin(), allowed.end(), op) != allowed.end())
+            continue;
+        bool known = std::find(int_ops.begin(), int_ops.end(), op) != int_ops.end() ||
+                     std::find(text_ops.begin(), text_ops.end(), op) != text_ops.end();
+        if (!known)
+            throw std::runtime_error("Unknown operator \"" + op + "\" on field \"" + field + "\"");
+        throw std::runtime_error("Operator \"" + op + "\" does not apply to field \"" + field + "\"");
+    }
+
+    if (is_int)
+    {
+        if (node["min"])
+            cond.min = as_int_operand(field, "min", node["min"]);
+        if (node["max"])
+            cond.max = as_int_operand(field, "max", node["max"]);
+        if (node["not"])
+            cond.not_int = as_int_operand(field, "not", node["not"]);
+        return cond;
+    }
+
+    if (node["any"])
+        cond.any = as_string_list(node["any"]);
+    if (node["none_of"])
+        cond.none_of = as_string_list(node["none_of"]);
+    if (node["not"])
+        cond.not_value = node["not"].as<std::string>();
+    if (node["contains"])
+        cond.contains = node["contains"].as<std::string>();
+    if (node["regex"])
+        cond.regex = node["regex"].as<std::string>();
+    if (node["ignore_case"])
+        cond.ignore_case = node["ignore_case"].as<bool>();
+
+    if (cond.ignore_case)
+    {
+        // fold operands once here so matching only folds the song's side
+        auto fold = [](std::optional<std::string> &s)
+        {
+            if (s)
+                s = fold_case(*s);
+        };
+        fold(cond.not_value);
+        fold(cond.contains);
+        for (auto &val : cond.any)
+            val = fold_case(val);
+        for (auto &val : cond.none_of)
+            val = fold_case(val);
+    }
+
+    if (cond.regex)
+    {
+        RE2::Options options;
+        options.set_case_sensitive(!cond.ignore_case);
+        options.set_log_errors(false);
+        auto re = std::make_shared<const RE2>(*cond.regex, options);
+        if (!re->ok())
+            throw std::runtime_error("Invalid regex \"" + *cond.regex + "\": " + re->error());
+        cond.compiled_regex = std::move(re);
+    }
+
+    return cond;
+}
+
+ConditionNode parse_condition_map(const YAML::Node &node)
+{
+    ConditionNode result;
+    result.kind = ConditionNode::Kind::And;
+
+    // "and"/"or" take a list of condition maps; "not" takes one map, or a
+    // list that is read as an implicit And
+    auto parse_list = [](const YAML::Node &list, ConditionNode::Kind kind)
+    {
+        ConditionNode group;
+        group.kind = kind;
+        if (list.IsSequence())
+        {
+            for (const auto &item : list)
+                group.children.push_back(parse_condition_map(item));
+        }
+        else
+        {
+            group.children.push_back(parse_condition_map(list));
+        }
+        return group;
+    };
+
+    for (const auto &it : node)
+    {
+        std::string key = it.first.as<std::string>();
+        if (key == "and")
+        {
+            result.children.push_back(parse_list(it.second, ConditionNode::Kind::And));
+        }
+        else if (key == "or")
+        {
+            result.children.push_back(parse_list(it.second, ConditionNode::Kind::Or));
+        }
+        else if (key == "not")
+        {
+            ConditionNode negation;
+            negation.kind = ConditionNode::Kind::Not;
+            negation.children.push_back(parse_list(it.second, ConditionNode::Kind::And));
+            result.children.push_back(std::move(negation));
+        }
+        else
+        {
+            ConditionNode leaf;
+            leaf.kind = ConditionNode::Kind::Field;
+            leaf.field = key;
+            leaf.cond = parse_field_condition(key, it.second);
+            result.children.push_back(std::move(leaf));
+        }
+    }
+
+    return result;
+}
+
+// Canonical text of a leaf; two leaves with the same key select the same songs.
+std::string condition_key(const std::string &field, const FieldCondition &cond)
+{
+    std::ostringstream key;
+    auto str = [&](const std::string &s)
+    { key << s.size() << ':' << s; };
+    auto opt_str = [&](const char *name, const std::optional<std::string> &s)
     {
-        std::vector<Song> selected;
-        for (const auto &song : songs)
+        if (s)
+        {
+            key << name << '=';
+            str(*s);
+        }
+    };
+    auto opt_int = [&](const char *name, const std::optional<int> &n)
+    {
+        if (n)
+            key << name << '=' << *n << ';';
+    };
+    auto list = [&](const char *name, const std::vector<std::string> &vec)
+    {
+        if (vec.empty())
+            return;
+        std::vector<std::string> sorted = vec;
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        key << name << '=' << sorted.size() << '[';
+        for (const auto &s : sorted)
+            str(s);
+        key << ']';
+    };
+
+    // binding every member by name makes a new FieldCondition member a
+    // compile error here until it is part of the key
+    const auto &[int_value, min, max, str_value, any, not_value, not_int,
+                 none_of, contains, regex, ignore_case, compiled_regex] = cond;
+    (void)compiled_regex; // compiled from regex, which is keyed
+
+    str(field);
+    opt_int("eq", int_value);
+    opt_int("min", min);
+    opt_int("max", max);
+    opt_int("ne", not_int);
+    opt_str("is", str_value);
+    list("any", any);
+    opt_str("not", not_value);
+    list("none_of", none_of);
+    opt_str("contains", contains);
+    opt_str("regex", regex);
+    if (ignore_case)
+        key << "icase;";
+    return key.str();
+}
+
+// Adds `node` and its sub-expressions to `plan`, reusing any node with the
+// same canonical key. Returns the index of the node and sets `key` to it.
+static size_t plan_node(const ConditionNode &node, PredicatePlan &plan,
+                        std::unordered_map<std::string, size_t> &seen, std::string &key)
+{
+    std::vector<size_t> children;
+    std::vector<std::string> child_keys;
+
+    if (node.kind == ConditionNode::Kind::Field)
+    {
+        key = "F(" + condition_key(node.field, node.cond) + ")";
+    }
+    else
+    {
+        std::vector<std::pair<std::string, size_t>> planned;
+        for (const auto &child : node.children)
+        {
+            std::string child_key;
+            size_t index = plan_node(child, plan, seen, child_key);
+            planned.emplace_back(std::move(child_key), index);
+        }
+
+        // and/or are commutative and idempotent: order and repeats don't matter
+        if (node.kind != ConditionNode::Kind::Not)
         {
-            bool matched = true;
-            for (const auto &[field, cond] : cfg.conditions)
+            std::sort(planned.begin(), planned.end());
+            planned.erase(std::unique(planned.begin(), planned.end()), planned.end());
+            // a single-operand and/or is its operand
+            if (planned.size() == 1)
             {
-                if (!matches_condition(song, field, cond))
-                {
-                    matched = false;
-                    break;
-                }
+                key = std::move(planned.front().first);
+                return planned.front().second;
             }
-            if (matched)
-                selected.push_back(song);
         }
 
-        if (!cfg.sort_by.empty())
+        const char *op = node.kind == ConditionNode::Kind::And  ? "A("
+                         : node.kind == ConditionNode::Kind::Or ? "O("
+                                                                : "N(";
+        key = op;
+        for (auto &[child_key, index] : planned)
         {
-            std::sort(selected.begin(), selected.end(), [&](const Song &a, const Song &b)
-                      {
-                          for (const auto &raw_key : cfg.sort_by)
-                          {
-                              bool descending = false;
-                              std::string key = raw_key;
-                              if (!key.empty() && key[0] == '-')
-                              {
-                                  descending = true;
-                                  key = key.substr(1);
-                              }
+            key += child_key;
+            key += ',';
+            children.push_back(index);
+        }
+        key += ')';
+    }
 
-                              if (key == "rating")
-                              {
-                                  if (a.rating != b.rating)
-                                      return descending ? a.rating < b.rating : a.rating > b.rating;
-                              }
-                              else if (key == "title")
-                              {
-                                  if (a.title != b.title)
-                                      return descending ? a.title > b.title : a.title < b.title;
-                              }
-                              else if (key == "album")
-                              {
-                                  if (a.album != b.album)
-                                      return descending ? a.album > b.album : a.album < b.album;
-                              }
-                              else if (key == "date_added")
-                              {
-                                  if (a.date_added != b.date_added)
-                                      return descending ? a.date_added > b.date_added : a.date_added < b.date_added;
-                              }
-                          }
-                          return a < b; // fallback to tie-break using <=>
-                      });
+    if (auto it = seen.find(key); it != seen.end())
+        return it->second;
+
+    PredicatePlan::Node planned_node{node.kind, {}, {}, std::move(children)};
+    if (node.kind == ConditionNode::Kind::Field)
+    {
+        planned_node.field = node.field;
+        planned_node.cond = node.cond;
+        planned_node.spec = &field_spec(node.field);
+    }
+    plan.nodes.push_back(std::move(planned_node));
+    seen.emplace(key, plan.nodes.size() - 1);
+    return plan.nodes.size() - 1;
+}
+
+PredicatePlan plan_predicates(const std::vector<PlaylistConfig> &configs)
+{
+    PredicatePlan plan;
+    std::unordered_map<std::string, size_t> seen;
+    for (const auto &cfg : configs)
+    {
+        std::string key;
+        plan.roots.push_back(plan_node(cfg.conditions, plan, seen, key));
+    }
+    return plan;
+}
+
+void FoldedFields::reset(const Song &song)
+{
+    song_ = &song;
+    ready_.fill(false);
+}
+
+const std::string &FoldedFields::text(const FieldSpec &spec)
+{
+    if (!ready_[spec.slot])
+    {
+        fold_case_into(spec.text_of(*song_), text_[spec.slot]);
+        ready_[spec.slot] = true;
+    }
+    return text_[spec.slot];
+}
+
+const std::vector<std::string> &FoldedFields::list(const FieldSpec &spec)
+{
+    if (!ready_[spec.slot])
+    {
+        const auto &values = spec.list_of(*song_);
+        auto &folded = list_[spec.slot];
+        folded.resize(values.size()); // keeps the surviving strings' buffers
+        for (size_t i = 0; i < values.size(); ++i)
+            fold_case_into(values[i], folded[i]);
+        ready_[spec.slot] = true;
+    }
+    return list_[spec.slot];
+}
+
+void evaluate_plan(const PredicatePlan &plan, const Song &song, FoldedFields &folds, std::vector<char> &results)
+{
+    folds.reset(song);
+    results.resize(plan.nodes.size());
+    for (size_t n = 0; n < plan.nodes.size(); ++n)
+    {
+        const auto &node = plan.nodes[n];
+        switch (node.kind)
+        {
+        case ConditionNode::Kind::Field:
+            results[n] = match_field(*node.spec, node.cond, song, folds);
+            break;
+        case ConditionNode::Kind::And: // an empty And matches everything
+            results[n] = std::all_of(node.children.begin(), node.children.end(), [&](size_t c)
+                                     { return results[c]; });
+            break;
+        case ConditionNode::Kind::Or:
+            results[n] = std::any_of(node.children.begin(), node.children.end(), [&](size_t c)
+                                     { return results[c]; });
+            break;
+        case ConditionNode::Kind::Not:
+            results[n] = !results[node.children.front()];
+            break;
         }
+    }
+}
 
-        std::ofstream out(out_dir + "/" + cfg.name + ".m3u8");
-        for (const auto &song : selected)
+bool track_precedes(const PlaylistTrack &a, const PlaylistTrack &b, const PlaylistConfig &cfg)
+{
+    for (const auto &raw_key : cfg.sort_by)
+    {
+        bool descending = false;
+        std::string key = raw_key;
+        if (!key.empty() && key[0] == '-')
+        {
+            descending = true;
+            key = key.substr(1);
+        }
+
+        if (key == "rating")
+        {
+            if (a.rating != b.rating)
+                return descending ? a.rating < b.rating : a.rating > b.rating;
+        }
+        else if (key == "title")
+        {
+            if (a.title != b.title)
+                return descending ? a.title > b.title : a.title < b.title;
+        }
+        else if (key == "album")
         {
-            out << "../music/" << song.path << "\n";
+            if (a.album != b.album)
+                return descending ? a.album > b.album : a.album < b.album;
         }
-        std::cout << "Wrote playlist: " << cfg.name << " (" << selected.size() << " tracks)\n";
+        else if (key == "date_added")
+        {
+            if (a.date_added != b.date_added)
+                return descending ? a.date_added > b.date_added : a.date_added < b.date_added;
+        }
+    }
+    return a.ordinal < b.ordinal; // songs arrive sorted, so this is the <=> tie-break
+}
+
+void order_playlist(std::vector<const PlaylistTrack *> &selected, const PlaylistConfig &cfg)
+{
+    if (cfg.shuffle)
+    {
+        std::vector<std::string> artists, albums;
+        artists.reserve(selected.size());
+        albums.reserve(selected.size());
+        for (const PlaylistTrack *track : selected)
+        {
+            artists.push_back(track->artist);
+            albums.push_back(track->album);
+        }
+
+        std::vector<const PlaylistTrack *> shuffled;
+        shuffled.reserve(selected.size());
+        for (size_t i : shuffle_order(artists, albums, *cfg.shuffle))
+            shuffled.push_back(selected[i]);
+        selected = std::move(shuffled);
+    }
+    else if (!cfg.sort_by.empty())
+    {
+        std::sort(selected.begin(), selected.end(), [&](const PlaylistTrack *a, const PlaylistTrack *b)
+                  { return track_precedes(*a, *b, cfg); });
+    }
+}
+
+static size_t track_footprint(const PlaylistTrack &track)
+{
+    return string_footprint(track.title) + string_footprint(track.album) + string_footprint(track.date_added) +
+           string_footprint(track.artist) + string_footprint(track.path);
+}
+
+static void write_track(std::ostream &out, const PlaylistTrack &track)
+{
+    uint64_t ordinal = track.ordinal;
+    int32_t rating = track.rating;
+    out.write(reinterpret_cast<const char *>(&ordinal), sizeof(ordinal));
+    out.write(reinterpret_cast<const char *>(&rating), sizeof(rating));
+    write_string(out, track.title);
+    write_string(out, track.album);
+    write_string(out, track.date_added);
+    write_string(out, track.artist);
+    write_string(out, track.path);
+}
+
+static bool read_track(std::istream &in, PlaylistTrack &track)
+{
+    uint64_t ordinal;
+    int32_t rating;
+    bool ok = in.read(reinterpret_cast<char *>(&ordinal), sizeof(ordinal)) &&
+              in.read(reinterpret_cast<char *>(&rating), sizeof(rating)) &&
+              read_string(in, track.title) &&
+              read_string(in, track.album) &&
+              read_string(in, track.date_added) &&
+              read_string(in, track.artist) &&
+              read_string(in, track.path);
+    track.ordinal = ordinal;
+    track.rating = rating;
+    return ok;
+}
+
+PlaylistSink::PlaylistSink(const std::string &config_path, const std::string &out_dir, size_t memory_budget)
+    : configs_(load_playlist_config(config_path)), plan_(plan_predicates(configs_)), out_dir_(out_dir),
+      members_(configs_.size()), memory_budget_(memory_budget), runs_(configs_.size())
+{
+}
+
+void PlaylistSink::begin(size_t)
+{
+    std::cout << "Evaluating " << plan_.nodes.size() << " distinct predicates for "
+              << configs_.size() << " playlists\n";
+}
+
+// Bytes held once the current song, costing `track_bytes` of strings, is
+// added to tracks_ and to the member lists of the playlists it matched.
+size_t PlaylistSink::projected_bytes(size_t track_bytes) const
+{
+    size_t bytes = string_bytes_ + track_bytes + capacity_after_push(tracks_) * sizeof(PlaylistTrack);
+    for (size_t p = 0; p < members_.size(); ++p)
+    {
+        const auto &members = members_[p];
+        size_t capacity = results_[plan_.roots[p]] ? capacity_after_push(members) : members.capacity();
+        bytes += capacity * sizeof(uint32_t);
     }
+    return bytes;
 }
 
-bool match_string_field(const std::string &value, const FieldCondition &cond)
+void PlaylistSink::consume(const Song &song)
 {
-    return !cond.str_value || value == *cond.str_value;
+    evaluate_plan(plan_, song, folds_, results_);
+
+    if (std::any_of(plan_.roots.begin(), plan_.roots.end(), [&](size_t root)
+                    { return results_[root]; }))
+    {
+        PlaylistTrack track{ordinal_, song.rating, song.title, song.album,
+                            song.date_added, join_artist(song.artist), song.path};
+        size_t track_bytes = track_footprint(track);
+        if (memory_budget_ > 0 && !tracks_.empty() && projected_bytes(track_bytes) > memory_budget_)
+            spill();
+
+        string_bytes_ += track_bytes;
+        tracks_.push_back(std::move(track));
+        for (size_t p = 0; p < configs_.size(); ++p)
+        {
+            if (results_[plan_.roots[p]])
+                members_[p].push_back(static_cast<uint32_t>(tracks_.size() - 1));
+        }
+    }
+    ++ordinal_;
+}
+
+void PlaylistSink::spill()
+{
+    for (size_t p = 0; p < configs_.size(); ++p)
+    {
+        if (members_[p].empty())
+            continue;
+
+        std::vector<const PlaylistTrack *> selected;
+        selected.reserve(members_[p].size());
+        for (uint32_t i : members_[p])
+            selected.push_back(&tracks_[i]);
+        // shuffled playlists are shuffled whole in finish(), so their runs stay in catalog order
+        if (!configs_[p].shuffle)
+            order_playlist(selected, configs_[p]);
+
+        fs::path run = spill_dir_.path() / ("playlist-" + std::to_string(p) + "-" + std::to_string(runs_[p].size()));
+        std::ofstream out(run, std::ios::binary);
+        for (const PlaylistTrack *track : selected)
+            write_track(out, *track);
+        if (!out)
+            throw std::runtime_error("Failed to write playlist run " + run.string());
+
+        runs_[p].push_back(run);
+        members_[p].clear(); // capacities stay within the budget they grew under
+    }
+    tracks_.clear();
+    string_bytes_ = 0;
+}
+
+void PlaylistSink::finish()
+{
+    // once anything is on disk, every playlist is merged back from its runs
+    if (std::any_of(runs_.begin(), runs_.end(), [](const auto &runs)
+                    { return !runs.empty(); }))
+        spill();
+
+    for (size_t p = 0; p < configs_.size(); ++p)
+    {
+        const auto &cfg = configs_[p];
+        std::ofstream out(out_dir_ + "/" + cfg.name + ".m3u8");
+        size_t count = 0;
+        auto write_entry = [&](const PlaylistTrack &track)
+        {
+            out << "../music/" << track.path << "\n";
+            ++count;
+        };
+
+        std::vector<PlaylistTrack> loaded; // spilled tracks of a shuffled playlist
+        std::vector<const PlaylistTrack *> selected;
+        if (runs_[p].empty())
+        {
+            selected.reserve(members_[p].size());
+            for (uint32_t i : members_[p])
+                selected.push_back(&tracks_[i]);
+        }
+        else if (cfg.shuffle)
+        {
+            // a shuffle needs every track of the playlist at once
+            merge_runs(runs_[p], spill_dir_.path(), std::vector<PlaylistTrack>{}, read_track, write_track,
+                       [](const PlaylistTrack &a, const PlaylistTrack &b)
+                       { return a.ordinal < b.ordinal; },
+                       [&](const PlaylistTrack &track)
+                       { loaded.push_back(track); });
+            for (const auto &track : loaded)
+                selected.push_back(&track);
+        }
+        else
+        {
+            merge_runs(runs_[p], spill_dir_.path(), std::vector<PlaylistTrack>{}, read_track, write_track,
+                       [&](const PlaylistTrack &a, const PlaylistTrack &b)
+                       { return track_precedes(a, b, cfg); },
+                       write_entry);
+        }
+
+        order_playlist(selected, cfg);
+        for (const PlaylistTrack *track : selected)
+            write_entry(*track);
+        std::cout << "Wrote playlist: " << cfg.name << " (" << count << " tracks)\n";
+    }
+}
+
+// Equality-style operators against a single value; `value` is already
+// case-folded when cond.ignore_case is set.
+static bool match_text(const std::string &value, const FieldCondition &cond)
+{
+    if (cond.not_value && value == *cond.not_value)
+        return false;
+    if (!cond.any.empty() && std::find(cond.any.begin(), cond.any.end(), value) == cond.any.end())
+        return false;
+    if (std::find(cond.none_of.begin(), cond.none_of.end(), value) != cond.none_of.end())
+        return false;
+    if (cond.contains && value.find(*cond.contains) == std::string::npos)
+        return false;
+    return true;
+}
+
+static bool match_regex(const std::string &value, const FieldCondition &cond)
+{
+    return !cond.compiled_regex || RE2::PartialMatch(value, *cond.compiled_regex);
+}
+
+bool match_field(const FieldSpec &spec, const FieldCondition &cond, const Song &song, FoldedFields &folds)
+{
+    switch (spec.kind)
+    {
+    case FieldSpec::Kind::Int:
+        return match_int_field(spec.int_of(song), cond);
+    case FieldSpec::Kind::Text:
+    {
+        const std::string &value = spec.text_of(song);
+        return match_string_field(value, cond.ignore_case ? folds.text(spec) : value, cond);
+    }
+    case FieldSpec::Kind::TextList:
+    {
+        const std::vector<std::string> &values = spec.list_of(song);
+        return match_string_vector_field(values, cond.ignore_case ? folds.list(spec) : values, cond);
+    }
+    }
+    return false;
+}
+
+bool match_string_field(const std::string &value, const std::string &folded, const FieldCondition &cond)
+{
+    if (cond.str_value && value != *cond.str_value)
+        return false;
+    if (!match_regex(value, cond))
+        return false;
+    return match_text(cond.ignore_case ? folded : value, cond);
 }
 
 bool match_int_field(int value, const FieldCondition &cond)
 {
     if (cond.int_value && value != *cond.int_value)
         return false;
+    if (cond.not_int && value == *cond.not_int)
+        return false;
     if (cond.min && value < *cond.min)
         return false;
     if (cond.max && value > *cond.max)
@@ -171,26 +717,30 @@ bool match_int_field(int value, const FieldCondition &cond)
     return true;
 }
 
-bool match_string_vector_field(const std::vector<std::string> &vec, const FieldCondition &cond)
+bool match_string_vector_field(const std::vector<std::string> &vec, const std::vector<std::string> &folded, const FieldCondition &cond)
 {
     if (cond.str_value)
     {
-        return std::find(vec.begin(), vec.end(), *cond.str_value) != vec.end();
+        if (std::find(vec.begin(), vec.end(), *cond.str_value) == vec.end())
+            return false;
     }
-    if (!cond.any.empty())
-    {
-        for (const auto &val : cond.any)
-        {
-            if (std::find(vec.begin(), vec.end(), val) != vec.end())
-                return true;
-        }
+
+    const std::vector<std::string> &values = cond.ignore_case ? folded : vec;
+
+    auto has = [&](const std::string &needle)
+    { return std::find(values.begin(), values.end(), needle) != values.end(); };
+
+    if (!cond.any.empty() && std::none_of(cond.any.begin(), cond.any.end(), has))
+        return false;
+    if (std::any_of(cond.none_of.begin(), cond.none_of.end(), has))
+        return false;
+    if (cond.not_value && has(*cond.not_value))
+        return false;
+    if (cond.contains && std::none_of(values.begin(), values.end(), [&](const std::string &val)
+                                      { return val.find(*cond.contains) != std::string::npos; }))
+        return false;
+    if (cond.compiled_regex && std::none_of(vec.begin(), vec.end(), [&](const std::string &val)
+                                            { return match_regex(val, cond); }))
         return false;
-    }
     return true;
 }
-
-bool matches_condition(const Song &song, const std::string &field, const FieldCondition &cond)
-{
-    auto it = match_funcs.find(field);
-    return it != match_funcs.end() ? it->second(song, cond) : false;
-}
\ No newline at end of file
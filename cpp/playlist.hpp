@@ -1,8 +1,15 @@
 #pragma once
 
 #include "song.hpp"
+#include "shuffle.hpp"
+#include "pipeline.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <unordered_map>
+#include <re2/re2.h>
+#include <yaml-cpp/yaml.h>
 
 struct FieldCondition
 {
@@ -11,21 +18,153 @@ struct FieldCondition
     std::optional<int> max;
     std::optional<std::string> str_value;
     std::vector<std::string> any;
+    std::optional<std::string> not_value; // "not" on string fields
+    std::optional<int> not_int;           // "not" on int fields
+    std::vector<std::string> none_of;
+    std::optional<std::string> contains;
+    std::optional<std::string> regex;
+    bool ignore_case = false; // string operands are stored case-folded
+
+    std::shared_ptr<const RE2> compiled_regex; // compiled once per config load
+};
+
+// Boolean expression over field conditions. A "conditions" map is an And of
+// its entries; the keys "and", "or" and "not" nest further maps.
+struct ConditionNode
+{
+    enum class Kind
+    {
+        Field,
+        And,
+        Or,
+        Not
+    };
+
+    Kind kind = Kind::And;
+    std::string field;  // Kind::Field only
+    FieldCondition cond; // Kind::Field only
+    std::vector<ConditionNode> children;
 };
 
 struct PlaylistConfig
 {
     std::string name;
-    std::map<std::string, FieldCondition> conditions;
+    ConditionNode conditions;
     std::vector<std::string> sort_by; // may include "-field" for descending
+    std::optional<ShuffleConfig> shuffle; // replaces sort_by when present
+};
+
+struct FieldSpec
+{
+    enum class Kind
+    {
+        Int,
+        Text,
+        TextList
+    };
+
+    Kind kind;
+    size_t slot; // index into FoldedFields
+    int (*int_of)(const Song &) = nullptr;
+    const std::string &(*text_of)(const Song &) = nullptr;
+    const std::vector<std::string> &(*list_of)(const Song &) = nullptr;
+};
+
+// Case-folded copies of one song's fields. Each is folded on first use by an
+// ignore_case condition and then shared by every other condition on that
+// song; the buffers keep their capacity from one song to the next.
+class FoldedFields
+{
+public:
+    static constexpr size_t slot_count = 9;
+
+    void reset(const Song &song);
+    const std::string &text(const FieldSpec &spec);
+    const std::vector<std::string> &list(const FieldSpec &spec);
+
+private:
+    const Song *song_ = nullptr;
+    std::array<bool, slot_count> ready_{};
+    std::array<std::string, slot_count> text_;
+    std::array<std::vector<std::string>, slot_count> list_;
+};
+
+// All playlists' conditions merged into one DAG in which structurally equal
+// sub-expressions appear once. Children always precede their parents, so
+// evaluating nodes in order never needs recursion.
+struct PredicatePlan
+{
+    struct Node
+    {
+        ConditionNode::Kind kind;
+        std::string field;
+        FieldCondition cond;
+        std::vector<size_t> children;
+        const FieldSpec *spec = nullptr; // Kind::Field only
+    };
+
+    std::vector<Node> nodes;
+    std::vector<size_t> roots; // one per playlist, in config order
+};
+
+// The part of a song a playlist still needs after selection.
+struct PlaylistTrack
+{
+    size_t ordinal; // catalog position; ties break on it like on Song::operator<=>
+    int rating;
+    std::string title;
+    std::string album;
+    std::string date_added;
+    std::string artist; // joined, for shuffling
+    std::string path;
+};
+
+// Selects songs for every playlist as they stream past, keeping only one
+// PlaylistTrack per selected song plus per-playlist index lists; finish()
+// orders each playlist and writes the .m3u8 files. When the buffered tracks
+// would exceed `memory_budget` bytes (0 means never spill), each playlist's
+// tracks are written out as an ordered run and merged back in finish().
+class PlaylistSink : public SongSink
+{
+public:
+    PlaylistSink(const std::string &config_path, const std::string &out_dir, size_t memory_budget = 0);
+    void begin(size_t total) override;
+    void consume(const Song &song) override;
+    void finish() override;
+
+private:
+    size_t projected_bytes(size_t track_bytes) const;
+    void spill();
+
+    std::vector<PlaylistConfig> configs_;
+    PredicatePlan plan_;
+    std::string out_dir_;
+    std::vector<char> results_; // per plan node, reused for every song
+    FoldedFields folds_;
+    std::vector<PlaylistTrack> tracks_;
+    std::vector<std::vector<uint32_t>> members_; // per playlist, indices into tracks_
+    size_t ordinal_ = 0;
+
+    size_t memory_budget_;
+    size_t string_bytes_ = 0; // heap held by tracks_' strings
+    SpillDir spill_dir_;
+    std::vector<std::vector<fs::path>> runs_; // per playlist
 };
 
 std::vector<PlaylistConfig> load_playlist_config(const std::string &config_path);
-void generate_playlists_from_config(const std::vector<Song> &songs, const std::string &config_path, const std::string &out_dir);
 
-bool match_string_field(const std::string &value, const FieldCondition &cond);
-bool match_int_field(int value, const FieldCondition &cond);
-bool match_string_vector_field(const std::vector<std::string> &vec, const FieldCondition &cond);
-bool matches_condition(const Song &song, const std::string &field, const FieldCondition &cond);
+ShuffleConfig parse_shuffle_config(const YAML::Node &node);
+const FieldSpec &field_spec(const std::string &field);
+FieldCondition parse_field_condition(const std::string &field, const YAML::Node &node);
+ConditionNode parse_condition_map(const YAML::Node &node);
+std::string condition_key(const std::string &field, const FieldCondition &cond);
+
+PredicatePlan plan_predicates(const std::vector<PlaylistConfig> &configs);
+void evaluate_plan(const PredicatePlan &plan, const Song &song, FoldedFields &folds, std::vector<char> &results);
+bool track_precedes(const PlaylistTrack &a, const PlaylistTrack &b, const PlaylistConfig &cfg);
+void order_playlist(std::vector<const PlaylistTrack *> &tracks, const PlaylistConfig &cfg);
 
-using MatchFunc = std::function<bool(const Song &, const FieldCondition &)>;
+bool match_field(const FieldSpec &spec, const FieldCondition &cond, const Song &song, FoldedFields &folds);
+bool match_string_field(const std::string &value, const std::string &folded, const FieldCondition &cond);
+bool match_int_field(int value, const FieldCondition &cond);
+bool match_string_vector_field(const std::vector<std::string> &vec, const std::vector<std::string> &folded, const FieldCondition &cond);
@@ -0,0 +1,157 @@
+#include "shuffle.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <set>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+// Groups `indices` by key, preserving their relative order within a group.
+static std::vector<std::vector<size_t>> group_by_key(const std::vector<size_t> &indices,
+                                                     const std::vector<std::string> &keys)
+{
+    std::unordered_map<std::string_view, size_t> group_of;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i : indices)
+    {
+        auto [it, inserted] = group_of.try_emplace(keys[i], groups.size());
+        if (inserted)
+            groups.emplace_back();
+        groups[it->second].push_back(i);
+    }
+    return groups;
+}
+
+// Spreads every group evenly over [0, 1): the k-th of m tracks lands at
+// (k + offset) / m with a random per-group offset and a little per-track
+// jitter, then all tracks are sorted by position.
+static std::vector<size_t> spread_order(const std::vector<size_t> &indices,
+                                        const std::vector<std::string> &keys,
+                                        std::mt19937_64 &rng)
+{
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<std::pair<double, size_t>> positioned;
+    positioned.reserve(indices.size());
+
+    for (auto &group : group_by_key(indices, keys))
+    {
+        std::shuffle(group.begin(), group.end(), rng);
+        const double m = static_cast<double>(group.size());
+        const double offset = unit(rng);
+        for (size_t k = 0; k < group.size(); ++k)
+        {
+            double jitter = (unit(rng) - 0.5) * 0.2;
+            positioned.emplace_back((static_cast<double>(k) + offset + jitter) / m, group[k]);
+        }
+    }
+
+    std::sort(positioned.begin(), positioned.end());
+    std::vector<size_t> result;
+    result.reserve(positioned.size());
+    for (const auto &[pos, i] : positioned)
+        result.push_back(i);
+    return result;
+}
+
+std::vector<size_t> shuffle_order(const std::vector<std::string> &artists,
+                                  const std::vector<std::string> &albums,
+                                  const ShuffleConfig &cfg)
+{
+    std::mt19937_64 rng(cfg.seed ? *cfg.seed : std::random_device{}());
+
+    std::vector<size_t> all(artists.size());
+    for (size_t i = 0; i < all.size(); ++i)
+        all[i] = i;
+
+    if (cfg.min_artist_gap <= 0)
+    {
+        if (cfg.spread_albums)
+            return spread_order(all, albums, rng);
+        std::shuffle(all.begin(), all.end(), rng);
+        return all;
+    }
+
+    // Start from an order that already spreads every artist (or, with
+    // spread_albums, every album) over the whole playlist, then walk it and
+    // take the earliest track whose artist is not cooling down. The artists
+    // with the most tracks left jump the queue only once their tracks would
+    // otherwise no longer fit the gap in the slots that remain.
+    std::vector<size_t> base = spread_order(all, cfg.spread_albums ? albums : artists, rng);
+    std::vector<size_t> rank(base.size());
+    for (size_t r = 0; r < base.size(); ++r)
+        rank[base[r]] = r;
+
+    std::vector<std::vector<size_t>> groups = group_by_key(base, artists); // each in base order
+    std::vector<size_t> next(groups.size(), 0);
+    auto left = [&](size_t g)
+    { return groups[g].size() - next[g]; };
+    auto rank_of_next = [&](size_t g)
+    { return rank[groups[g][next[g]]]; };
+
+    // ready artists by their next track's rank, and by most tracks left then
+    // earliest rank; cooling artists wait in FIFO order of the step they are ready at
+    using Heaviest = std::tuple<size_t, size_t, size_t>; // tracks left, rank from the end, group
+    std::set<std::pair<size_t, size_t>> by_rank;
+    std::set<Heaviest> by_left;
+    std::deque<std::pair<size_t, size_t>> cooling;
+
+    // how many artists have each number of tracks left, and the largest number
+    std::vector<size_t> artists_with(all.size() + 1, 0);
+    size_t most_left = 0;
+
+    auto make_ready = [&](size_t g)
+    {
+        by_rank.emplace(rank_of_next(g), g);
+        by_left.emplace(left(g), base.size() - rank_of_next(g), g);
+    };
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        make_ready(g);
+        ++artists_with[left(g)];
+        most_left = std::max(most_left, left(g));
+    }
+
+    std::vector<size_t> result;
+    result.reserve(all.size());
+    const size_t gap = static_cast<size_t>(cfg.min_artist_gap);
+
+    for (size_t step = 0; step < all.size(); ++step)
+    {
+        while (!cooling.empty() && cooling.front().first <= step)
+        {
+            make_ready(cooling.front().second);
+            cooling.pop_front();
+        }
+
+        size_t g;
+        if (!by_rank.empty())
+        {
+            g = by_rank.begin()->second;
+            // the k artists with m tracks left need (m - 1) * (gap + 1) + k
+            // slots; once that is all that remains, most-left-first is what
+            // keeps the gap, or relaxes it least often when it cannot hold
+            if ((most_left - 1) * (gap + 1) + artists_with[most_left] >= all.size() - step)
+                g = std::get<2>(*by_left.rbegin());
+            by_rank.erase({rank_of_next(g), g});
+            by_left.erase({left(g), base.size() - rank_of_next(g), g});
+        }
+        else
+        {
+            // the gap cannot be kept; take the artist that has waited longest
+            g = cooling.front().second;
+            cooling.pop_front();
+        }
+
+        --artists_with[left(g)];
+        result.push_back(groups[g][next[g]++]);
+        ++artists_with[left(g)];
+        while (most_left > 0 && artists_with[most_left] == 0)
+            --most_left;
+        if (next[g] < groups[g].size())
+            cooling.emplace_back(step + gap + 1, g);
+    }
+
+    return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct ShuffleConfig
+{
+    std::optional<uint64_t> seed; // std::random_device when absent
+    int min_artist_gap = 0;       // other tracks required between two by the same artist
+    bool spread_albums = false;   // place tracks of one album evenly apart
+};
+
+// Returns a permutation of [0, artists.size()) honouring `cfg`. `artists` and
+// `albums` hold the grouping key of each track. Runs in O(n log n); when a
+// single artist dominates so that min_artist_gap cannot hold, the gap is
+// relaxed for the surplus tracks instead of failing.
+std::vector<size_t> shuffle_order(const std::vector<std::string> &artists,
+                                  const std::vector<std::string> &albums,
+                                  const ShuffleConfig &cfg);
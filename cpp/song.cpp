@@ -1,5 +1,8 @@
 // song.cpp
 #include "song.hpp"
+#ifdef MUSIC_CATALOG_ALLOC_STATS
+#include "alloc_stats.hpp"
+#endif
 
 #include <unicode/coll.h>
 #include <unicode/locid.h>
@@ -48,6 +51,39 @@ int compare_str(const std::string &a, const std::string &b)
     return collator->compare(ua, ub);
 }
 
+void append_collation_key(std::string &out, const std::string &s)
+{
+    // ICU sort keys are 0-terminated with no interior 0 bytes, so appended
+    // keys stay unambiguous; equal keys <=> compare_str() == 0
+    icu::UnicodeString us = icu::UnicodeString::fromUTF8(s);
+    size_t start = out.size();
+    out.resize(start + 64);
+    int32_t len = collator->getSortKey(us, reinterpret_cast<uint8_t *>(out.data() + start), 64);
+    if (len > 64)
+    {
+        out.resize(start + len);
+        collator->getSortKey(us, reinterpret_cast<uint8_t *>(out.data() + start), len);
+    }
+    out.resize(start + len);
+}
+
+std::string duplicate_key(const Song &song)
+{
+    // mirrors Song::operator==
+    std::string key;
+    key += std::to_string(song.artist.size());
+    key += '\0';
+    for (const auto &a : song.artist)
+        append_collation_key(key, a);
+    append_collation_key(key, song.album);
+    key += std::to_string(get_num(song.discnumber));
+    key += '\0';
+    key += std::to_string(get_num(song.tracknumber));
+    key += '\0';
+    append_collation_key(key, song.title);
+    return key;
+}
+
 int compare_vec(const std::vector<std::string> &a, const std::vector<std::string> &b)
 {
     size_t n = std::min(a.size(), b.size());
@@ -130,70 +166,235 @@ std::string join_artist(const std::vector<std::string> &artist)
     return result;
 }
 
+void fold_case_into(const std::string &s, std::string &out)
+{
+    // ASCII fast path; everything else goes through ICU full case folding.
+    // Both reuse out's capacity.
+    if (std::all_of(s.begin(), s.end(), [](unsigned char c)
+                    { return c < 0x80; }))
+    {
+        out.resize(s.size());
+        std::transform(s.begin(), s.end(), out.begin(), ::tolower);
+        return;
+    }
+    out.clear();
+    icu::UnicodeString::fromUTF8(s).foldCase().toUTF8String(out);
+}
+
+std::string fold_case(const std::string &s)
+{
+    std::string result;
+    fold_case_into(s, result);
+    return result;
+}
+
+// Property keys are built once; passing string literals would construct a
+// TagLib::String for every lookup of every file.
+static const TagLib::String key_title("TITLE");
+static const TagLib::String key_album("ALBUM");
+static const TagLib::String key_discnumber("DISCNUMBER");
+static const TagLib::String key_tracknumber("TRACKNUMBER");
+static const TagLib::String key_artist("ARTIST");
+static const TagLib::String key_genre("GENRE");
+static const TagLib::String key_comment("COMMENT");
+static const TagLib::String key_rating("RATING");
+static const TagLib::String key_date_added("DATE_ADDED");
+
 Song parse_song_tags(const fs::path &path, const std::string &ext, TagLib::File *file)
 {
     TagLib::PropertyMap props = file->properties();
 
-    std::string title = get_first(props, "TITLE");
-    std::string album = get_first(props, "ALBUM");
-    std::string discnumber = get_first(props, "DISCNUMBER");
-    std::string tracknumber = get_first(props, "TRACKNUMBER");
-    std::vector<std::string> artist = get_list(props, "ARTIST");
-    if (artist.empty())
-        artist = {"$unknown$"};
-    std::vector<std::string> genre = get_list(props, "GENRE");
-    if (genre.empty())
-        genre = {"$unknown$"};
-
-    int rating = -1;
-    std::string date_added;
+    Song song{
+        .title = get_first(props, key_title),
+        .artist = get_list(props, key_artist),
+        .album = get_first(props, key_album),
+        .genre = get_list(props, key_genre),
+        .rating = -1,
+        .discnumber = get_first(props, key_discnumber),
+        .tracknumber = get_first(props, key_tracknumber),
+        .path = {}, // set by scan_songs once any rename is done
+        .date_added = {}};
+    if (song.artist.empty())
+        song.artist.emplace_back("$unknown$");
+    if (song.genre.empty())
+        song.genre.emplace_back("$unknown$");
 
     if (ext == "m4a")
     {
-        std::string comment = get_first(props, "COMMENT");
-        try
-        {
-            auto j = json::parse(comment);
-            genre = j["genre"].get<std::vector<std::string>>();
-            rating = j["rating"];
-            date_added = j["date_added"];
-        }
-        catch (...)
-        {
+        std::string comment = get_first(props, key_comment);
+        if (!parse_m4a_comment(comment, song.genre, song.rating, song.date_added))
             std::cerr << "Invalid JSON COMMENT in " << path << "\n";
-        }
     }
     else
     {
-        std::string rating_str = get_first(props, "RATING");
+        std::string rating_str = get_first(props, key_rating);
         try
         {
-            rating = std::stoi(rating_str);
+            song.rating = std::stoi(rating_str);
         }
         catch (...)
         {
             std::cerr << "Invalid RATING in " << path << "\n";
-            rating = -1;
+            song.rating = -1;
         }
-        date_added = get_first(props, "DATE_ADDED");
+        song.date_added = get_first(props, key_date_added);
     }
 
-    return Song{
-        .title = title,
-        .artist = artist,
-        .album = album,
-        .genre = genre,
-        .rating = rating,
-        .discnumber = discnumber,
-        .tracknumber = tracknumber,
-        .path = path.filename().string(),
-        .date_added = date_added};
+    return song;
 }
 
-std::vector<Song> parse_all_songs(const std::string &directory)
+// SAX handler that pulls "genre", "rating" and "date_added" out of the
+// top-level object without building a json DOM. Values of other keys are
+// skipped; a wrongly typed value for one of the three aborts the parse.
+struct CommentSaxHandler
 {
-    std::vector<Song> songs;
+    enum class Key
+    {
+        None,
+        Genre,
+        Rating,
+        DateAdded
+    };
+
+    int depth = 0;
+    Key current = Key::None;
+    bool in_genre = false;
+    bool valid = true;
+
+    std::optional<std::vector<std::string>> genre;
+    std::optional<int> rating;
+    std::optional<std::string> date_added;
+
+    // `accepts` is the key this kind of scalar is a legitimate value for
+    bool scalar(Key accepts)
+    {
+        if (depth == 0)
+            return valid = false; // root must be an object
+        if (in_genre && depth == 2)
+            return valid = accepts == Key::Genre;
+        if (depth > 1)
+            return true;
+        return valid = current == Key::None || current == accepts;
+    }
+
+    bool null() { return scalar(Key::None); }
+    bool boolean(bool) { return scalar(Key::None); }
+    bool binary(json::binary_t &) { return scalar(Key::None); }
+
+    bool number_integer(json::number_integer_t val)
+    {
+        if (!scalar(Key::Rating))
+            return false;
+        if (depth == 1 && current == Key::Rating)
+            rating = static_cast<int>(val);
+        return true;
+    }
+
+    bool number_unsigned(json::number_unsigned_t val)
+    {
+        return number_integer(static_cast<json::number_integer_t>(val));
+    }
+
+    bool number_float(json::number_float_t val, const json::string_t &)
+    {
+        return number_integer(static_cast<json::number_integer_t>(val));
+    }
+
+    bool string(json::string_t &val)
+    {
+        if (in_genre && depth == 2)
+        {
+            genre->push_back(std::move(val));
+            return true;
+        }
+        if (!scalar(Key::DateAdded))
+            return false;
+        if (depth == 1 && current == Key::DateAdded)
+            date_added = std::move(val);
+        return true;
+    }
+
+    bool key(json::string_t &val)
+    {
+        if (depth != 1)
+            return true;
+        if (val == "genre")
+            current = Key::Genre;
+        else if (val == "rating")
+            current = Key::Rating;
+        else if (val == "date_added")
+            current = Key::DateAdded;
+        else
+            current = Key::None;
+        return true;
+    }
+
+    bool start_object(std::size_t)
+    {
+        if ((in_genre && depth == 2) || (depth == 1 && current != Key::None))
+            return valid = false;
+        ++depth;
+        return true;
+    }
+
+    bool end_object()
+    {
+        --depth;
+        return true;
+    }
 
+    bool start_array(std::size_t)
+    {
+        if (depth == 0 || (in_genre && depth == 2))
+            return valid = false;
+        if (depth == 1 && current == Key::Genre)
+        {
+            in_genre = true;
+            genre.emplace(); // a repeated key replaces the earlier value
+        }
+        else if (depth == 1 && current != Key::None)
+        {
+            return valid = false;
+        }
+        ++depth;
+        return true;
+    }
+
+    bool end_array()
+    {
+        if (--depth == 1)
+            in_genre = false;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &)
+    {
+        return valid = false;
+    }
+};
+
+CommentParseStats comment_stats;
+
+bool parse_m4a_comment(const std::string &comment, std::vector<std::string> &genre, int &rating, std::string &date_added)
+{
+    CommentSaxHandler handler;
+    bool ok = json::sax_parse(comment, &handler) && handler.valid &&
+              handler.genre && handler.rating && handler.date_added;
+    if (!ok)
+    {
+        ++comment_stats.malformed;
+        return false;
+    }
+
+    ++comment_stats.parsed;
+    genre = std::move(*handler.genre);
+    rating = *handler.rating;
+    date_added = std::move(*handler.date_added);
+    return true;
+}
+
+void scan_songs(const std::string &directory, bool rename_files, const std::function<void(Song &&)> &emit)
+{
     for (const auto &entry : fs::directory_iterator(directory))
     {
         if (!entry.is_regular_file())
@@ -205,27 +406,52 @@ std::vector<Song> parse_all_songs(const std::string &directory)
         if (std::find(accepted_exts.begin(), accepted_exts.end(), ext) == accepted_exts.end())
             continue;
 
+#ifdef MUSIC_CATALOG_ALLOC_STATS
+        size_t allocs_before = thread_alloc_count();
+#endif
         TagLib::FileRef ref(path.c_str());
         verify_file_extension(path, ext, ref);
 
         Song song = parse_song_tags(path, ext, ref.file());
 
-        std::string artist_joined = join_artist(song.artist);
-        auto [disc_int, disc_part] = parse_track_or_disc(song.discnumber);
-        auto [track_int, track_part] = parse_track_or_disc(song.tracknumber);
+        if (rename_files)
+        {
+            std::string artist_joined = join_artist(song.artist);
+            auto [disc_int, disc_part] = parse_track_or_disc(song.discnumber);
+            auto [track_int, track_part] = parse_track_or_disc(song.tracknumber);
 
-        std::string ext_out = path.extension().string();
-        std::string_view ext_out_view = ext_out;
-        if (!ext_out_view.empty() && ext_out_view[0] == '.')
-            ext_out_view.remove_prefix(1);
+            std::string ext_out = path.extension().string();
+            std::string_view ext_out_view = ext_out;
+            if (!ext_out_view.empty() && ext_out_view[0] == '.')
+                ext_out_view.remove_prefix(1);
 
-        std::string safe_filename = build_safe_filename(artist_joined, song.album, disc_part, track_part, song.title, ext_out_view);
-        try_rename_file(path, safe_filename);
+            std::string safe_filename = build_safe_filename(artist_joined, song.album, disc_part, track_part, song.title, ext_out_view);
+            try_rename_file(path, safe_filename);
+        }
 
         song.path = path.filename().string();
-        songs.push_back(song);
+#ifdef MUSIC_CATALOG_ALLOC_STATS
+        record_file_allocs(path, thread_alloc_count() - allocs_before);
+#endif
+        emit(std::move(song));
     }
 
+    if (comment_stats.malformed > 0)
+        std::cerr << "Malformed JSON COMMENT: " << comment_stats.malformed << " of "
+                  << comment_stats.parsed + comment_stats.malformed << " m4a files\n";
+}
+
+size_t count_directory_entries(const std::string &directory)
+{
+    return static_cast<size_t>(std::distance(fs::directory_iterator(directory), fs::directory_iterator{}));
+}
+
+std::vector<Song> parse_all_songs(const std::string &directory, bool rename_files)
+{
+    std::vector<Song> songs;
+    songs.reserve(count_directory_entries(directory));
+    scan_songs(directory, rename_files, [&](Song &&song)
+               { songs.push_back(std::move(song)); });
     std::sort(songs.begin(), songs.end());
     return songs;
 }
@@ -239,7 +465,7 @@ std::string get_lowercase_ext(const fs::path &path)
     return ext;
 }
 
-std::string get_first(const TagLib::PropertyMap &map, const std::string &key)
+std::string get_first(const TagLib::PropertyMap &map, const TagLib::String &key)
 {
     auto it = map.find(key);
     if (it != map.end())
@@ -251,19 +477,20 @@ std::string get_first(const TagLib::PropertyMap &map, const std::string &key)
         }
         else
         {
-            std::cerr << "Warning: Property \"" << key << "\" has "
+            std::cerr << "Warning: Property \"" << key.to8Bit(true) << "\" has "
                       << list.size() << " values; expected exactly 1.\n";
         }
     }
     return "$unknown$";
 }
 
-std::vector<std::string> get_list(const TagLib::PropertyMap &map, const std::string &key)
+std::vector<std::string> get_list(const TagLib::PropertyMap &map, const TagLib::String &key)
 {
     std::vector<std::string> result;
     auto it = map.find(key);
     if (it != map.end())
     {
+        result.reserve(it->second.size());
         for (const auto &val : it->second)
         {
             result.push_back(val.to8Bit(true));
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <compare>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -43,17 +46,39 @@ struct Song
 
 int compare_str(const std::string &a, const std::string &b);
 int compare_vec(const std::vector<std::string> &a, const std::vector<std::string> &b);
+void append_collation_key(std::string &out, const std::string &s);
+std::string duplicate_key(const Song &song);
 int get_num(const std::string &s);
 int parse_number(const std::string &s);
 std::string sanitize_filename(const std::string &input);
 std::string join_artist(const std::vector<std::string> &artist);
+void fold_case_into(const std::string &s, std::string &out);
+std::string fold_case(const std::string &s);
 
+// Counters for the JSON COMMENT tag that m4a files carry instead of
+// GENRE/RATING/DATE_ADDED properties.
+struct CommentParseStats
+{
+    std::atomic<size_t> parsed{0};
+    std::atomic<size_t> malformed{0};
+};
+
+extern CommentParseStats comment_stats;
+
+bool parse_m4a_comment(const std::string &comment, std::vector<std::string> &genre, int &rating, std::string &date_added);
 Song parse_song_tags(const fs::path &path, const std::string &ext, TagLib::File *file);
-std::vector<Song> parse_all_songs(const std::string &directory);
+// Scans and tags every accepted file, handing each song to `emit` in
+// directory order; parse_all_songs collects and sorts them. With
+// `rename_files` each file is first renamed to its metadata-based name;
+// report-only modes must pass false, since identically tagged copies map to
+// the same name and rename() would replace one with the other.
+void scan_songs(const std::string &directory, bool rename_files, const std::function<void(Song &&)> &emit);
+std::vector<Song> parse_all_songs(const std::string &directory, bool rename_files);
+size_t count_directory_entries(const std::string &directory);
 
 std::string get_lowercase_ext(const fs::path &path);
-std::string get_first(const TagLib::PropertyMap &map, const std::string &key);
-std::vector<std::string> get_list(const TagLib::PropertyMap &map, const std::string &key);
+std::string get_first(const TagLib::PropertyMap &map, const TagLib::String &key);
+std::vector<std::string> get_list(const TagLib::PropertyMap &map, const TagLib::String &key);
 
 enum class FileType
 {
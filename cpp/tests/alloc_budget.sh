@@ -0,0 +1,37 @@
+# usage: alloc_budget.sh <music-catalog> <python> <repo root> <work dir> <budget>
+# Scans a generated fixture library in both modes; music-catalog exits with
+# status 2 when a file goes over MUSIC_CATALOG_ALLOC_BUDGET allocations. A
+# budget of 0 disables that check, so the test then fails after printing the
+# measured per-file max.
+set -e
+catalog=$1
+python=$2
+repo=$3
+work=$4
+budget=$5
+
+rm -rf "$work" && mkdir -p "$work/music" "$work/playlists"
+"$python" "$repo/cpp/tests/make_fixtures.py" "$work/music"
+cp "$repo/playlists.yaml" "$work/"
+count=$(ls "$work/music" | wc -l)
+cd "$work"
+
+# runs the catalog and checks it scanned every fixture
+check()
+{
+    log=$1
+    shift
+    status=0
+    "$catalog" "$@" > "$log" || status=$?
+    cat "$log"
+    [ "$status" -eq 0 ] && grep -q "over $count files" "$log"
+}
+
+# read-only first, so the scan below still sees the generated names
+check dups.log --find-duplicates music
+check scan.log --max-memory 64K music
+
+if [ "$budget" -eq 0 ]; then
+    echo "MUSIC_CATALOG_ALLOC_BUDGET is not set; configure it just above the max printed above" >&2
+    exit 1
+fi
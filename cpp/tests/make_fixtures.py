@@ -0,0 +1,83 @@
+"""Writes a small library of tagged FLAC and MP3 files for the alloc_budget test.
+
+The files carry real tag blocks (and, for MP3, a few empty frames), which is
+all TagLib needs to parse them; the audio itself is never decoded.
+"""
+
+import struct
+import sys
+from pathlib import Path
+
+SONGS = [
+    # (title, artist, album, genre, rating, date_added)
+    ("Morning", "Alice", "First Light", "Pop", 10, "2024-01-05"),
+    ("Evening", "Alice", "First Light", "Pop", 8, "2024-01-06"),
+    ("Sonata No. 1", "Bruno", "Piano Works", "Classical", 9, "2024-02-01"),
+    ("Sonata No. 2", "Bruno", "Piano Works", "Classical", 7, "2024-02-01"),
+    ("Highway", "Carmen; Dario", "Roads", "Rock", 6, "2024-03-12"),
+]
+
+
+def flac_block(block_type: int, payload: bytes, last: bool) -> bytes:
+    header = (0x80 if last else 0) | block_type
+    return bytes([header]) + len(payload).to_bytes(3, "big") + payload
+
+
+def flac_file(tags: dict) -> bytes:
+    # 44.1 kHz, 2 channels, 16 bits, unknown length, no MD5
+    info = struct.pack(">HH", 4096, 4096) + bytes(6)
+    info += ((44100 << 44) | (1 << 41) | (15 << 36)).to_bytes(8, "big") + bytes(16)
+
+    vendor = b"music-catalog fixtures"
+    comment = struct.pack("<I", len(vendor)) + vendor + struct.pack("<I", len(tags))
+    for key, value in tags.items():
+        entry = f"{key}={value}".encode()
+        comment += struct.pack("<I", len(entry)) + entry
+
+    return b"fLaC" + flac_block(0, info, False) + flac_block(4, comment, True)
+
+
+def syncsafe(n: int) -> bytes:
+    return bytes([(n >> 21) & 0x7F, (n >> 14) & 0x7F, (n >> 7) & 0x7F, n & 0x7F])
+
+
+def id3_frame(frame_id: str, data: bytes) -> bytes:
+    return frame_id.encode() + syncsafe(len(data)) + b"\x00\x00" + data
+
+
+def mp3_file(tags: dict) -> bytes:
+    utf8 = b"\x03"
+    frames = id3_frame("TIT2", utf8 + tags["TITLE"].encode())
+    frames += id3_frame("TPE1", utf8 + tags["ARTIST"].encode())
+    frames += id3_frame("TALB", utf8 + tags["ALBUM"].encode())
+    frames += id3_frame("TCON", utf8 + tags["GENRE"].encode())
+    frames += id3_frame("TRCK", utf8 + tags["TRACKNUMBER"].encode())
+    for key in ("RATING", "DATE_ADDED"):
+        frames += id3_frame("TXXX", utf8 + key.encode() + b"\x00" + tags[key].encode())
+    tag = b"ID3\x04\x00\x00" + syncsafe(len(frames)) + frames
+
+    # MPEG-1 layer III, 128 kbps, 44.1 kHz: 417-byte frames
+    frame = b"\xff\xfb\x90\x64" + bytes(413)
+    return tag + frame * 8
+
+
+def main():
+    out_dir = Path(sys.argv[1])
+    out_dir.mkdir(parents=True, exist_ok=True)
+
+    for i, (title, artist, album, genre, rating, date_added) in enumerate(SONGS):
+        tags = {
+            "TITLE": title,
+            "ARTIST": artist,
+            "ALBUM": album,
+            "GENRE": genre,
+            "RATING": str(rating),
+            "DATE_ADDED": date_added,
+            "TRACKNUMBER": str(i + 1),
+        }
+        (out_dir / f"{i:02d}.flac").write_bytes(flac_file(tags))
+        (out_dir / f"{i:02d}.mp3").write_bytes(mp3_file(tags))
+
+
+if __name__ == "__main__":
+    main()
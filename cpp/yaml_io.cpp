@@ -45,7 +45,7 @@ void emit_song(YAML::Emitter &out, const Song &s)
     out << YAML::EndMap;
 }
 
-void write_songs_to_yaml(const std::vector<Song> &songs, const std::string &filename)
+static std::string generation_time()
 {
     // Get local time with timezone offset
     std::time_t now = std::time(nullptr);
@@ -62,19 +62,94 @@ void write_songs_to_yaml(const std::vector<Song> &songs, const std::string &file
     time_info << (offset_seconds >= 0 ? " +" : " -")
               << std::setw(2) << std::setfill('0') << std::abs(offset_hours)
               << ":" << std::setw(2) << std::setfill('0') << offset_minutes;
+    return time_info.str();
+}
+
+YamlSongSink::YamlSongSink(const std::string &filename)
+    : filename_(filename), out_(fout_)
+{
+}
+
+void YamlSongSink::begin(size_t total)
+{
+    fout_.open(filename_);
+    fout_ << "# Generated by music_catalog on " << generation_time() << "\n";
+    fout_ << "# Tracks count: " << total << "\n\n";
+    out_ << YAML::BeginSeq;
+}
+
+void YamlSongSink::consume(const Song &song)
+{
+    emit_song(out_, song);
+    ++count_;
+}
+
+void YamlSongSink::finish()
+{
+    out_ << YAML::EndSeq;
+    fout_.flush();
+    std::cout << "Saved " << count_ << " songs to " << filename_ << "\n";
+}
 
+void write_duplicates_to_yaml(const std::vector<DuplicateGroup> &groups, const std::string &filename)
+{
     YAML::Emitter out;
     out << YAML::BeginSeq;
-    for (const auto &song : songs)
+    for (const auto &group : groups)
     {
-        emit_song(out, song);
+        const Song &first = *group.tracks.front().song;
+        out << YAML::BeginMap;
+        out << YAML::Key << "title";
+        emit_string(out, first.title);
+        out << YAML::Key << "artist";
+        emit_string_vector(out, first.artist);
+        out << YAML::Key << "album";
+        emit_string(out, first.album);
+        if (group.verified)
+        {
+            // one entry per format with two or more copies; empty when every copy is in its own format
+            out << YAML::Key << "identical_audio" << YAML::Value;
+            if (group.identical_audio.empty())
+                out << YAML::Flow;
+            out << YAML::BeginMap;
+            for (const auto &[format, identical] : group.identical_audio)
+                out << YAML::Key << format << YAML::Value << identical;
+            out << YAML::EndMap;
+        }
+
+        out << YAML::Key << "tracks" << YAML::Value << YAML::BeginSeq;
+        for (const auto &track : group.tracks)
+        {
+            out << YAML::BeginMap;
+            out << YAML::Key << "path";
+            emit_string(out, track.song->path);
+            if (group.verified)
+            {
+                out << YAML::Key << "duration_ms" << YAML::Value << track.duration_ms;
+                out << YAML::Key << "fingerprint" << YAML::Value;
+                if (track.fingerprint)
+                {
+                    std::ostringstream fingerprint;
+                    fingerprint << std::hex << std::setw(16) << std::setfill('0') << *track.fingerprint;
+                    out << YAML::DoubleQuoted << fingerprint.str();
+                }
+                else
+                {
+                    out << YAML::Null; // file unreadable or container malformed
+                }
+            }
+            out << YAML::EndMap;
+        }
+        out << YAML::EndSeq;
+
+        out << YAML::EndMap;
     }
     out << YAML::EndSeq;
 
     std::ofstream fout(filename);
-    fout << "# Generated by music_catalog on " << time_info.str() << "\n";
-    fout << "# Tracks count: " << songs.size() << "\n\n";
+    fout << "# Generated by music_catalog on " << generation_time() << "\n";
+    fout << "# Duplicate groups: " << groups.size() << "\n\n";
     fout << out.c_str();
 
-    std::cout << "Saved " << songs.size() << " songs to " << filename << "\n";
+    std::cout << "Saved " << groups.size() << " duplicate groups to " << filename << "\n";
 }
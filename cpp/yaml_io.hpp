@@ -2,6 +2,8 @@
 #pragma once
 
 #include "song.hpp"
+#include "duplicates.hpp"
+#include "pipeline.hpp"
 #include <yaml-cpp/yaml.h>
 #include <fstream>
 #include <regex>
@@ -12,4 +14,22 @@ bool is_yaml_sensitive(const std::string &s);
 void emit_string(YAML::Emitter &out, const std::string &s);
 void emit_string_vector(YAML::Emitter &out, const std::vector<std::string> &vec);
 void emit_song(YAML::Emitter &out, const Song &s);
-void write_songs_to_yaml(const std::vector<Song> &songs, const std::string &filename);
+
+// Writes songs.yaml incrementally as songs arrive instead of building the
+// whole document in memory.
+class YamlSongSink : public SongSink
+{
+public:
+    explicit YamlSongSink(const std::string &filename);
+    void begin(size_t total) override;
+    void consume(const Song &song) override;
+    void finish() override;
+
+private:
+    std::string filename_;
+    std::ofstream fout_;
+    YAML::Emitter out_;
+    size_t count_ = 0;
+};
+
+void write_duplicates_to_yaml(const std::vector<DuplicateGroup> &groups, const std::string &filename);